@@ -0,0 +1,48 @@
+# Runs gcache on a tight time budget, over and over, in a tree with a file
+# too large to hash within the budget, and checks that every file gets cached
+# eventually, the large one included.
+# usage: cmake -DGCACHE=<gcache executable> -DWORK_DIR=<scratch dir> -P BudgetTest.cmake
+
+if(NOT GCACHE OR NOT WORK_DIR)
+    message(FATAL_ERROR "GCACHE and WORK_DIR must be set")
+endif()
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+# "a" comes first in most directory listings
+file(MAKE_DIRECTORY "${WORK_DIR}/a" "${WORK_DIR}/b")
+string(REPEAT "0123456789abcdef" 65536 chunk)
+foreach(i RANGE 1 32)
+    file(APPEND "${WORK_DIR}/a/big.bin" "${chunk}${i}")
+endforeach()
+set(fileCount 9)
+foreach(i RANGE 2 ${fileCount})
+    file(WRITE "${WORK_DIR}/b/${i}.txt" "${i}\n")
+endforeach()
+
+set(maxRuns 1000)
+foreach(run RANGE 1 ${maxRuns})
+    execute_process(COMMAND "${GCACHE}" --budget 10
+        WORKING_DIRECTORY "${WORK_DIR}" RESULT_VARIABLE result OUTPUT_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "gcache failed on run ${run}: ${result}")
+    endif()
+    set(entries)
+    if(EXISTS "${WORK_DIR}/.hash_cache.txt")
+        file(STRINGS "${WORK_DIR}/.hash_cache.txt" entries)
+    endif()
+    list(LENGTH entries count)
+    set(runs ${run})
+    if(count EQUAL fileCount AND NOT EXISTS "${WORK_DIR}/.hash_partial.txt")
+        break()
+    endif()
+endforeach()
+if(NOT count EQUAL fileCount)
+    message(FATAL_ERROR "${count} of ${fileCount} files cached after ${maxRuns} runs")
+endif()
+
+file(MD5 "${WORK_DIR}/a/big.bin" bigHash)
+string(FIND "${entries}" " ${bigHash} \"a/big.bin\"" found)
+if(found EQUAL -1)
+    message(FATAL_ERROR "wrong hash of resumed file: ${entries}, expected ${bigHash}")
+endif()
+message(STATUS "all files cached after ${runs} runs")
@@ -4,24 +4,25 @@
 #include "Common/Config.hpp"
 #include "GCacheCore/RecursiveDirectoryIterator.hpp"
 #include "GCacheCore/MD5.hpp"
+#include "GCacheCore/SHA1.hpp"
+#include "GCacheCore/FileStat.hpp"
+#include "GCacheCore/GitIndex.hpp"
+#include "GCacheCore/Trace.hpp"
+#include "GCacheCore/FileLock.hpp"
+#include "GCacheCore/Manifest.hpp"
+#include "GCacheCore/CacheEntry.hpp"
 #include <cstdint>
+#include <chrono>
 #include <string>
 #include <fstream> // std::ifstream, std::ofstream
-#include <algorithm> // std::min
 #include <unordered_map>
-#include <cstdio> // std::printf, std::puts
+#include <optional>
+#include <thread> // std::this_thread::sleep_for
+#include <cstdio> // std::printf, std::puts, std::fprintf
 #include <cstring> // std::strchr
 
 namespace GCache
 {
-static std::string_view Trim(std::string_view s)
-{
-    char const *trimChars = " \"\t\r\v\n";
-    s.remove_prefix(std::min(s.find_first_not_of(trimChars), s.size()));
-    s.remove_suffix(std::min(s.size() - s.find_last_not_of(trimChars) - 1, s.size()));
-    return s;
-}
-
 static bool Verbose = false;
 
 template <typename... TArgs>
@@ -38,58 +39,54 @@ static void Log(char const *format, TArgs ...args)
 
 namespace fs = std::filesystem;
 
-class CacheEntry
+// Tracks time budget of an update and periodically reports its progress to
+// stderr, so that long runs (e.g. cold cache in a git hook) aren't silent.
+class Progress
 {
 public:
-    int64_t Timestamp;
-    std::string Hash;
+    using Clock = std::chrono::steady_clock;
 
 private:
-    std::string_view ConsumeToken(std::string_view &src, bool consumeSpaces = false)
-    {
-        auto space = src.find_first_of(" \t");
-        if (space == std::string::npos || consumeSpaces)
-            space = src.length();
-        auto token = src.substr(0, space);
-        src = Trim(src.substr(space));
-        return token;
-    }
+    static constexpr auto ReportInterval = std::chrono::seconds(1);
+    Clock::time_point start = Clock::now();
+    Clock::time_point lastReport = start;
+    Clock::time_point deadline = Clock::time_point::max();
 
 public:
-    fs::path Load(std::ifstream &fs)
+    uint64_t Files = 0;
+    uint64_t Bytes = 0;
+    uint64_t ExpectedFiles = 0;
+
+    void Start(Clock::time_point deadline = Clock::time_point::max())
     {
-        // "912309182 9283109238 git/libschmoo/schmoo.h"
-        std::string line = "<empty line>";
-        do
-        {
-            if (!std::getline(fs, line))
-                break;
-            auto lv = Trim(std::string_view(line));
-            auto tsview = ConsumeToken(lv);
-            if (tsview.empty())
-                break;
-            if (std::sscanf(tsview.data(), "%lld", &Timestamp) != 1)
-                break;
-            Hash = ConsumeToken(lv);
-            if (Hash.empty())
-                break;
-            std::filesystem::path path = ConsumeToken(lv, true);
-            if (path.empty())
-                break;
-            return path.lexically_normal();
-        }
-        while (false);
-        throw std::runtime_error("unrecognized entry: " + line);
+        start = lastReport = Clock::now();
+        this->deadline = deadline;
+        Files = Bytes = 0;
     }
 
-    void Save(std::ofstream &fs, fs::path path) const
+    bool Expired() const
+    { return Clock::now() >= deadline; }
+
+    void Report()
     {
-        char buf[32];
-        std::snprintf(buf, sizeof(buf), "%lld", Timestamp);
-        fs << buf << " " << std::string(Hash) << " " << path.lexically_normal() << "\n";
+        auto now = Clock::now();
+        if (now - lastReport < ReportInterval)
+            return;
+        lastReport = now;
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        double fileRate = Files / elapsed;
+        double byteRate = Bytes / elapsed / (1024*1024);
+        char eta[32] = "unknown";
+        if (Files < ExpectedFiles && fileRate > 0)
+            std::snprintf(eta, sizeof(eta), "%.0fs", (ExpectedFiles - Files) / fileRate);
+        std::fprintf(stderr, "* progress: %llu files (%.0f files/s), %.1f MB (%.1f MB/s), ETA %s\n",
+            (unsigned long long)Files, fileRate, Bytes / double(1024*1024), byteRate, eta);
     }
 };
 
+// thrown when time budget runs out in the middle of an update
+struct BudgetExhausted {};
+
 class Cache
 {
 private:
@@ -100,16 +97,95 @@ private:
         { return fs::hash_value(p); }
     };
     std::unordered_map<fs::path, CacheEntry, PathHasher> files;
+    std::unordered_map<fs::path, SnapshotEntry, PathHasher> snapshot;
+    // file which hashing was interrupted by time budget, empty if none
+    fs::path partialPath;
+    PartialHash partial;
+    GitIndex gitIndex;
+    Manifest changes;
+    Progress progress;
+    Progress::Clock::time_point deadline = Progress::Clock::time_point::max();
+    size_t maxHistory = 0;
+    std::optional<FileLock> lock;
+    int64_t started = 0;
+    bool current = false;
+    bool completed = false;
     bool modified = false;
 
-    static std::string Hash(fs::path const &path)
+    // hashes content with MD5 and, if blob is given, as a git blob in one pass
+    void Hash(std::istream &src, MD5 &md5, SHA1 *blob)
+    {
+        char buf[64*1024];
+        for (bool first = true; src.read(buf, sizeof(buf)), src.gcount(); first = false)
+        {
+            // at least one chunk per file, so that runs on a tight budget
+            // still make progress on files too large to hash in one go
+            if (!first && progress.Expired())
+                throw BudgetExhausted();
+            auto rsize = src.gcount();
+            md5.Update(buf, uint32_t(rsize));
+            if (blob)
+                blob->Update(buf, uint32_t(rsize));
+            progress.Bytes += rsize;
+            progress.Report();
+        }
+    }
+
+    // Picks up hashing where an interrupted run stopped, unless the file has
+    // changed since. Returns number of bytes already hashed.
+    uint64_t Resume(fs::path const &path, std::istream &src, MD5 &md5, std::optional<SHA1> &blob)
     {
+        if (path != partialPath)
+            return 0;
+        partialPath.clear();
+        FileStat st;
+        if (st.Read(path) && partial.Matches(st) && blob.has_value() == !partial.BlobState.empty()
+            && md5.LoadState(partial.MD5State) && (!blob || blob->LoadState(partial.BlobState))
+            && src.seekg(partial.Offset))
+        {
+            Log("*   resuming hash at %llu bytes: " FPATH, (unsigned long long)partial.Offset, path.c_str());
+            return partial.Offset;
+        }
+        md5 = MD5();
+        if (blob)
+            blob = SHA1::GitBlob(fs::file_size(path));
+        src.clear();
+        src.seekg(0);
+        return 0;
+    }
+
+    ContentHashes Hash(fs::path const &path, bool withBlobId = false)
+    {
+        Trace::Scope scope("Cache::Hash", path);
+        auto bytes = progress.Bytes;
+        MD5 md5;
+        std::optional<SHA1> blob;
+        uint64_t offset = 0;
         try
         {
             std::ifstream ifs(path, std::ios::binary);
-            MD5 md5;
-            md5.Update(ifs).Finalize();
-            return md5.Digest();
+            if (withBlobId)
+                blob = SHA1::GitBlob(fs::file_size(path));
+            offset = Resume(path, ifs, md5, blob);
+            Hash(ifs, md5, blob ? &*blob : nullptr);
+            scope.Bytes(progress.Bytes - bytes);
+            ContentHashes hashes;
+            if (blob)
+                hashes.BlobId = blob->Finalize().Digest();
+            hashes.MD5 = md5.Finalize().Digest();
+            return hashes;
+        }
+        catch (BudgetExhausted &)
+        {
+            scope.Bytes(progress.Bytes - bytes);
+            if (partial.Stat.Read(path))
+            {
+                partialPath = path;
+                partial.Offset = offset + (progress.Bytes - bytes);
+                partial.MD5State = md5.SaveState();
+                partial.BlobState = blob ? blob->SaveState() : std::string();
+            }
+            throw;
         }
         catch (...)
         {
@@ -128,6 +204,7 @@ private:
 
     static void Timestamp(fs::path const &path, int64_t ts)
     {
+        Trace::Scope scope("Cache::RestoreTimestamp", path);
         std::error_code ec;
         auto newTime = fs::file_time_type(fs::file_time_type::clock::duration(ts));
         fs::last_write_time(path, newTime, ec);
@@ -137,15 +214,21 @@ private:
 
 public:
     static constexpr char const *FileName = ".hash_cache.txt";
-    
+    static constexpr char const *SnapshotFileName = ".hash_snapshot.txt";
+    static constexpr char const *LockFileName = ".hash_cache.lock";
+    static constexpr char const *PartialFileName = ".hash_partial.txt";
+
     void Reset()
     {
         files.clear();
+        partialPath.clear();
+        changes.Reset();
         modified = false;
     }
 
     void Load(char const *root = ".")
     {
+        Trace::Scope scope("Cache::Load");
         Reset();
         Log("* loading cache");
         try
@@ -170,16 +253,271 @@ public:
             throw e;
         }
         Log("* %u files cached", uint32_t(files.size()));
+        LoadPartial(root);
+    }
+
+    // A run on time budget saves state of the hash it was interrupted in, so
+    // that files too large to hash within the budget are still hashed over
+    // several runs instead of blocking the rest of the tree. The state is
+    // only a shortcut: it's ignored if anything is wrong with it.
+    void LoadPartial(char const *root = ".")
+    {
+        partialPath.clear();
+        auto path = fs::path(root) / PartialFileName;
+        if (!fs::exists(path))
+            return;
+        try
+        {
+            std::ifstream ifs(path, std::ios::binary);
+            partialPath = partial.Load(ifs).relative_path();
+        }
+        catch (std::exception &e)
+        {
+            partialPath.clear();
+            Log("! partial hash ignored: %s", e.what());
+        }
+    }
+
+    void SavePartial(char const *root = ".")
+    {
+        auto path = fs::path(root) / PartialFileName;
+        if (partialPath.empty())
+        {
+            std::error_code ec;
+            fs::remove(path, ec);
+            return;
+        }
+        std::ofstream ofs(path, std::ios::binary);
+        partial.Save(ofs, partialPath);
+    }
+
+    // Blob IDs from git index let Update skip reading files that git
+    // considers unmodified. They seed new entries and are only ever compared
+    // with other blob IDs, never with hashes of filtered working tree content
+    // (see FileContent): a file passed through git filters (eol conversion,
+    // LFS) is reported as updated once, when its stat first stops matching
+    // the index, and is keyed by MD5 from then on.
+    void LoadGitIndex(char const *root = ".")
+    {
+        gitIndex.Reset();
+        auto path = GitIndex::Locate(root);
+        if (path.empty())
+        {
+            Log("* git index not found");
+            return;
+        }
+        Log("* loading git index: " FPATH, path.c_str());
+        try
+        {
+            gitIndex.Load(path);
+        }
+        catch (std::exception &e)
+        {
+            gitIndex.Reset();
+            Log("! git index ignored: %s", e.what());
+            return;
+        }
+        Log("* %u files indexed", uint32_t(gitIndex.Size()));
+    }
+
+    // First phase of wrapping a git operation: records stat data of all
+    // files without reading them. The cache itself is neither loaded nor
+    // modified.
+    void Snapshot(char const *root = ".")
+    {
+        Trace::Scope scope("Cache::Snapshot");
+        Log("* taking snapshot");
+        uint32_t count{};
+        try
+        {
+            std::ofstream ofs(fs::path(root) / SnapshotFileName, std::ios::binary);
+            for (RecursiveDirectoryIterator rec(root); rec; ++rec)
+            {
+                auto path = rec.Path().relative_path().lexically_normal();
+                if (path.filename().c_str()[0] == '.')
+                {
+                    if (rec.Directory())
+                        rec.Skip();
+                    continue;
+                }
+                if (rec.Directory())
+                    continue;
+                SnapshotEntry entry;
+                if (!entry.Stat.Read(path))
+                    throw std::runtime_error("can't read file stat: " + path.string());
+                entry.Save(ofs, path);
+                count++;
+            }
+        }
+        catch (std::exception &e)
+        {
+            std::error_code ec;
+            fs::remove(fs::path(root) / SnapshotFileName, ec);
+            Log("! error while taking snapshot: %s", e.what());
+            throw e;
+        }
+        Log("- snapshot completed: files[%u]", count);
+    }
+
+    // Second phase: once loaded, Update skips files which stat data didn't
+    // change since the snapshot, so only files rewritten by git get hashed.
+    // Returns false if there's no snapshot.
+    bool LoadSnapshot(char const *root = ".")
+    {
+        snapshot.clear();
+        auto path = fs::path(root) / SnapshotFileName;
+        if (!fs::exists(path))
+            return false;
+        Log("* loading snapshot");
+        try
+        {
+            std::ifstream ifs(path, std::ios::binary);
+            while (ifs.peek(), ifs.good())
+            {
+                SnapshotEntry entry;
+                auto path = entry.Load(ifs).relative_path();
+                snapshot[path] = entry;
+            }
+        }
+        catch (std::exception &e)
+        {
+            snapshot.clear();
+            Log("! error while loading snapshot: %s", e.what());
+            throw e;
+        }
+        Log("* %u files in snapshot", uint32_t(snapshot.size()));
+        return true;
+    }
+
+    // snapshot is consumed by a completed update, an interrupted one keeps it
+    // so that the next restore picks up the rest
+    void DropSnapshot(char const *root = ".")
+    {
+        snapshot.clear();
+        std::error_code ec;
+        fs::remove(fs::path(root) / SnapshotFileName, ec);
+    }
+
+    // Limits duration of the run, counting from now: once the budget runs
+    // out, Lock gives up waiting, or Update stops and only entries verified
+    // so far are saved. Since verified entries match file timestamps, the
+    // next run passes them with a single stat call and continues hashing
+    // where this one stopped. Zero means no limit.
+    void SetBudget(std::chrono::milliseconds ms)
+    { deadline = ms.count() ? Progress::Clock::now() + ms : Progress::Clock::time_point::max(); }
+
+    // Number of earlier versions kept per file. When content returns to one
+    // of them (e.g. switching back and forth between branches), its original
+    // timestamp is restored. That's only safe if build outputs of that version
+    // are still around (separate build directories per branch, or a build
+    // system/compiler cache keyed by content), so history is off by default.
+    void SetHistory(size_t depth)
+    { maxHistory = depth; }
+
+    // Serializes runs in the same tree, so that concurrent hooks don't
+    // redo each other's work or overwrite each other's results. The lock file
+    // keeps start time of the last completed update: if it began after this
+    // process was invoked, the cache is already current (see Current).
+    // Returns false if the time budget ran out while waiting.
+    bool Lock(char const *root = ".")
+    {
+        using namespace std::chrono;
+        auto invoked = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+        auto path = fs::path(root) / LockFileName;
+        lock.emplace(path);
+        if (!lock->TryLock())
+        {
+            Log("* waiting for another gcache run to finish");
+            if (deadline == Progress::Clock::time_point::max())
+                lock->Lock();
+            else
+            {
+                while (!lock->TryLock())
+                {
+                    if (Progress::Clock::now() >= deadline)
+                        return false;
+                    std::this_thread::sleep_for(milliseconds(10));
+                }
+            }
+            long long lastStart = 0;
+            std::ifstream ifs(path, std::ios::binary);
+            current = ifs >> lastStart && lastStart >= invoked;
+        }
+        // this run starts now, as far as concurrent runs are concerned
+        started = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+        return true;
+    }
+
+    // true if a concurrent update which started after this process had been
+    // invoked completed while Lock was waiting
+    bool Current() const noexcept
+    { return current; }
+
+    void Unlock(char const *root = ".")
+    {
+        if (!lock)
+            return;
+        if (completed)
+        {
+            std::ofstream ofs(fs::path(root) / LockFileName, std::ios::binary);
+            ofs << started << "\n";
+        }
+        lock.reset();
     }
     
-    void Update(char const *root = ".")
+    // Drops entries of files which no longer exist or are ignored, without
+    // walking the tree or reading files, and rewrites the cache. Update prunes
+    // entries by itself, but only when it's not interrupted by time budget.
+    void Compact()
+    {
+        Trace::Scope scope("Cache::Compact");
+        Log("* compacting cache");
+        uint32_t removed{};
+        for (auto it = files.begin(); it != files.end();)
+        {
+            auto const &path = it->first;
+            bool ignored = false;
+            for (auto const &part : path)
+                ignored |= part.c_str()[0] == '.';
+            std::error_code ec;
+            if (!ignored && fs::is_regular_file(path, ec))
+            {
+                ++it;
+                continue;
+            }
+            Log("*   removing: " FPATH, path.c_str());
+            it = files.erase(it);
+            removed++;
+        }
+        files.rehash(0);
+        modified = true;
+        Log("- compaction completed: removed[%u], kept[%u]", removed, uint32_t(files.size()));
+    }
+
+    // files which content changed during the last Update, deleted files are
+    // included only if the update wasn't interrupted
+    Manifest const &Changes() const noexcept
+    { return changes; }
+
+    // returns false if the update was interrupted by time budget
+    bool Update(char const *root = ".")
     {
         Log("* updating cache");
-        uint32_t ignored{}, checked{}, restored{}, updated{}, new_{};
+        changes.Reset();
+        uint32_t ignored{}, checked{}, restored{}, reverted{}, updated{}, new_{}, indexed{}, skipped{}, deleted{};
+        bool exhausted = false;
+        // on a cold or partially filled cache (after running out of budget),
+        // git index tells roughly how many files there are
+        uint64_t indexSize = gitIndex.Size() ? gitIndex.Size() : GitIndex::Count(GitIndex::Locate(root));
+        progress.ExpectedFiles = files.size() > indexSize ? files.size() : indexSize;
+        progress.Start(deadline);
         try
         {
             for (RecursiveDirectoryIterator rec(root); rec; ++rec)
             {
+                if (progress.Expired())
+                    throw BudgetExhausted();
+                progress.Report();
                 auto path = rec.Path().relative_path().lexically_normal();
                 if (path.filename().c_str()[0] == '.')
                 {
@@ -191,49 +529,128 @@ public:
                 }
                 if (rec.Directory())
                     continue;
-                auto &entry = files[path];
-                if (entry.Hash.empty())
+                progress.Files++;
+                auto it = files.find(path);
+                if (it != files.end())
+                    it->second.Visited = true;
+                FileStat st;
+                SHA1::DigestType const *blobId = nullptr;
+                if ((gitIndex.Size() || !snapshot.empty()) && st.Read(path))
+                {
+                    // files missing in the cache are hashed even if git didn't touch them
+                    auto snap = snapshot.find(path);
+                    if (snap != snapshot.end() && snap->second.Matches(st) && it != files.end())
+                    {
+                        // untouched by git, but may have been edited before the
+                        // snapshot; content isn't checked to keep restore cheap
+                        if (Timestamp(path) != it->second.Timestamp)
+                            changes.Add(Manifest::Change::Modified, path);
+                        skipped++;
+                        continue;
+                    }
+                    if (gitIndex.Size())
+                        blobId = gitIndex.BlobId(path, st);
+                }
+                if (it == files.end())
                 {
-                    Log("*   new file: " FPATH, path.c_str());                    
-                    entry.Hash = Hash(path);
+                    // entry is added only once hashed, so that an interrupted
+                    // update doesn't leave incomplete entries behind
+                    Log("*   new file: " FPATH, path.c_str());
+                    CacheEntry entry;
+                    if (blobId)
+                    {
+                        entry.Hash = *blobId;
+                        indexed++;
+                    }
+                    else
+                        entry.Hash = Hash(path).MD5;
                     entry.Timestamp = Timestamp(path);
+                    entry.Visited = true;
+                    files.emplace(path, std::move(entry));
+                    changes.Add(Manifest::Change::Added, path);
                     new_++;
                     continue;
                 }
+                auto &entry = it->second;
                 Log("*   checking: " FPATH, path.c_str());
                 auto ts = Timestamp(path);
                 checked++;
                 if (ts == entry.Timestamp)
                     continue;
-                auto hash = Hash(path);
-                if (hash == entry.Hash)
+                if (blobId && CacheEntry::IsBlobId(entry.Hash))
+                    indexed++;
+                FileContent content(entry, blobId, [&](bool withBlobId) { return Hash(path, withBlobId); });
+                if (content.Matches(entry.Hash))
                 {
                     Log("*   restoring timestamp: " FPATH, path.c_str());                   
                     Timestamp(path, entry.Timestamp);
                     restored++;
                     continue;
                 }
+                if (auto version = maxHistory ? entry.FindVersion(content) : nullptr)
+                {
+                    Log("*   restoring earlier version timestamp: " FPATH, path.c_str());
+                    auto versionTs = version->Timestamp;
+                    // the version keeps its key type
+                    auto versionHash = version->Hash;
+                    Timestamp(path, versionTs);
+                    entry.Push(versionHash, versionTs, maxHistory);
+                    changes.Add(Manifest::Change::Modified, path);
+                    reverted++;
+                    continue;
+                }
                 Log("*   updating: " FPATH, path.c_str());
-                entry.Hash = hash;
-                entry.Timestamp = ts;
+                entry.Push(content.Key(entry), ts, maxHistory);
+                changes.Add(Manifest::Change::Modified, path);
                 updated++;
             }            
         }
+        catch (BudgetExhausted &)
+        {
+            exhausted = true;
+        }
         catch (std::exception &e)
         {
             Reset();
             Log("! error while updating cache: %s", e.what());
             throw e;
         }
-        modified = updated || new_;
-        Log("- update completed: ignored[%u], checked[%u], restored[%u], updated[%u], new[%u]",
-            ignored, checked, restored, updated, new_);
+        // a full pass either finished the interrupted hash or found the file gone
+        if (!exhausted)
+            partialPath.clear();
+        SavePartial(root);
+        // entries of deleted or renamed files are only known after a full pass
+        if (!exhausted)
+        {
+            for (auto it = files.begin(); it != files.end();)
+            {
+                if (it->second.Visited)
+                {
+                    ++it;
+                    continue;
+                }
+                Log("*   deleted: " FPATH, it->first.c_str());
+                changes.Add(Manifest::Change::Deleted, it->first);
+                it = files.erase(it);
+                deleted++;
+            }
+        }
+        modified = reverted || updated || new_ || deleted;
+        Log("- update %s: ignored[%u], checked[%u], restored[%u], reverted[%u], updated[%u], new[%u], indexed[%u], skipped[%u], deleted[%u]",
+            exhausted ? "interrupted" : "completed",
+            ignored, checked, restored, reverted, updated, new_, indexed, skipped, deleted);
+        if (exhausted)
+            Log("- time budget exhausted, update will resume on next run");
+        // only a full pass makes the cache current for concurrent runs
+        completed = !exhausted && snapshot.empty();
+        return !exhausted;
     }
     
     void Save(char const *root = ".")
     {
         if (!modified)
             return;
+        Trace::Scope scope("Cache::Save");
         Log("* saving cache");
         try
         {
@@ -250,35 +667,140 @@ public:
     }
 };
 
+static constexpr unsigned MaxHistory = 16;
+
+static char const *Usage =
+    "usage: gcache [snapshot|restore] [--verbose] [--git-index] [--budget <ms>] [--trace=<file>]\n"
+    "              [--manifest=<file> [--manifest-format=nul|json]] [--compact] [--history <n>]";
 } // namespace GCache
 
 int main(int argc, char const **argv)
 {
     using namespace GCache;
-    switch (argc)
+    enum class Command { Update, Snapshot, Restore } command = Command::Update;
+    bool useGitIndex = false;
+    bool compact = false;
+    long long budget = 0;
+    unsigned history = 0;
+    char const *tracePath = nullptr;
+    char const *manifestPath = nullptr;
+    auto manifestFormat = Manifest::Format::Nul;
+    for (int i = 1; i < argc; i++)
     {
-    case 1:
-        break;
-    case 2:
-        if (!std::strcmp(argv[1], "--verbose"))
-        {
+        if (i == 1 && !std::strcmp(argv[i], "snapshot"))
+            command = Command::Snapshot;
+        else if (i == 1 && !std::strcmp(argv[i], "restore"))
+            command = Command::Restore;
+        else if (!std::strcmp(argv[i], "--verbose"))
             Verbose = true;
-            break;
+        else if (!std::strcmp(argv[i], "--git-index"))
+            useGitIndex = true;
+        else if (!std::strcmp(argv[i], "--compact"))
+            compact = true;
+        else if (!std::strcmp(argv[i], "--budget"))
+        {
+            if (++i == argc || std::sscanf(argv[i], "%lld", &budget) != 1 || budget <= 0)
+            {
+                Log("! --budget expects a positive number of milliseconds");
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--history"))
+        {
+            if (++i == argc || std::sscanf(argv[i], "%u", &history) != 1 || history > MaxHistory)
+            {
+                Log("! --history expects a number of versions from 0 to %u", MaxHistory);
+                return 1;
+            }
         }
-    default:
-        Log("! unrecognized option (only --verbose is available)");
+        else if (!std::strncmp(argv[i], "--trace=", 8) && argv[i][8])
+            tracePath = argv[i] + 8;
+        else if (!std::strncmp(argv[i], "--manifest=", 11) && argv[i][11])
+            manifestPath = argv[i] + 11;
+        else if (!std::strcmp(argv[i], "--manifest-format=nul"))
+            manifestFormat = Manifest::Format::Nul;
+        else if (!std::strcmp(argv[i], "--manifest-format=json"))
+            manifestFormat = Manifest::Format::Json;
+        else
+        {
+            Log("! unrecognized option: %s", argv[i]);
+            Log("! %s", Usage);
+            return 1;
+        }
+    }
+    if (compact && command != Command::Update)
+    {
+        Log("! --compact can't be combined with snapshot or restore");
         return 1;
     }
+    if (tracePath)
+        Trace::Enable();
+    // manifest is only written by a completed update, its absence tells build
+    // system that changes are unknown
+    if (manifestPath)
+    {
+        std::error_code ec;
+        fs::remove(manifestPath, ec);
+    }
+    int result = 0;
     try
     {
         Cache cache;
-        cache.Load();
-        cache.Update();
-        cache.Save();
+        cache.SetBudget(std::chrono::milliseconds(budget));
+        cache.SetHistory(history);
+        if (!cache.Lock())
+            Log("- time budget exhausted while waiting for another gcache run");
+        else if (command == Command::Snapshot)
+            cache.Snapshot();
+        else if (compact)
+        {
+            cache.Load();
+            cache.Compact();
+            cache.Save();
+        }
+        else if (command == Command::Update && cache.Current())
+            Log("- cache is up to date: updated by a concurrent run");
+        else
+        {
+            cache.Load();
+            if (useGitIndex)
+                cache.LoadGitIndex();
+            if (command == Command::Restore && !cache.LoadSnapshot())
+                Log("! snapshot not found, checking all files");
+            bool completed = cache.Update();
+            cache.Save();
+            if (command == Command::Restore && completed)
+                cache.DropSnapshot();
+            if (manifestPath && completed)
+            {
+                try
+                {
+                    cache.Changes().Save(manifestPath, manifestFormat);
+                }
+                catch (std::exception &e)
+                {
+                    Log("! error while saving manifest: %s", e.what());
+                    throw e;
+                }
+            }
+        }
+        cache.Unlock();
     }
     catch (...)
     {
-        return 1;
+        result = 1;
+    }
+    if (tracePath)
+    {
+        try
+        {
+            Trace::Save(tracePath);
+        }
+        catch (std::exception &e)
+        {
+            Log("! error while saving trace: %s", e.what());
+            result = 1;
+        }
     }
-    return 0;
+    return result;
 }
@@ -0,0 +1,264 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#include "Common/Config.hpp"
+#include "CacheEntry.hpp"
+#include <algorithm> // std::min
+#include <cstdio> // std::sscanf, std::snprintf
+#include <stdexcept> // std::runtime_error
+#include <string_view>
+
+namespace GCache
+{
+namespace fs = std::filesystem;
+
+static std::string_view Trim(std::string_view s)
+{
+    char const *trimChars = " \"\t\r\v\n";
+    s.remove_prefix(std::min(s.find_first_not_of(trimChars), s.size()));
+    s.remove_suffix(std::min(s.size() - s.find_last_not_of(trimChars) - 1, s.size()));
+    return s;
+}
+
+static std::string_view ConsumeToken(std::string_view &src, bool consumeSpaces = false)
+{
+    auto space = src.find_first_of(" \t");
+    if (space == std::string::npos || consumeSpaces)
+        space = src.length();
+    auto token = src.substr(0, space);
+    src = Trim(src.substr(space));
+    return token;
+}
+
+bool CacheEntry::IsBlobId(std::string const &hash) noexcept
+{ return hash.size() == 2*sizeof(SHA1::DigestType::Data); }
+
+bool CacheEntry::HasBlobIds() const noexcept
+{
+    if (IsBlobId(Hash))
+        return true;
+    for (auto &version : History)
+    {
+        if (IsBlobId(version.Hash))
+            return true;
+    }
+    return false;
+}
+
+CacheEntry::Version *CacheEntry::FindVersion(FileContent &content)
+{
+    for (auto &version : History)
+    {
+        if (content.Matches(version.Hash))
+            return &version;
+    }
+    return nullptr;
+}
+
+void CacheEntry::Push(std::string hash, int64_t ts, size_t maxHistory)
+{
+    History.insert(History.begin(), {Timestamp, std::move(Hash)});
+    for (auto it = History.begin() + 1; it != History.end();)
+    {
+        if (it->Hash == hash)
+            it = History.erase(it);
+        else
+            ++it;
+    }
+    if (History.size() > maxHistory)
+        History.resize(maxHistory);
+    Hash = std::move(hash);
+    Timestamp = ts;
+}
+
+fs::path CacheEntry::Load(std::istream &fs)
+{
+    // "912309182 9283109238 git/libschmoo/schmoo.h"
+    // "912309182 9283109238,912309100:1283109238 git/libschmoo/schmoo.h"
+    std::string line = "<empty line>";
+    do
+    {
+        if (!std::getline(fs, line))
+            break;
+        auto lv = Trim(std::string_view(line));
+        auto tsview = ConsumeToken(lv);
+        if (tsview.empty())
+            break;
+        long long ts;
+        if (std::sscanf(tsview.data(), "%lld", &ts) != 1)
+            break;
+        Timestamp = ts;
+        auto versions = ConsumeToken(lv);
+        auto comma = versions.find(',');
+        Hash = versions.substr(0, comma);
+        if (Hash.empty())
+            break;
+        History.clear();
+        bool valid = true;
+        while (valid && comma != std::string_view::npos)
+        {
+            versions.remove_prefix(comma + 1);
+            comma = versions.find(',');
+            auto token = versions.substr(0, comma);
+            auto colon = token.find(':');
+            valid = colon != std::string_view::npos && colon + 1 < token.size()
+                && std::sscanf(std::string(token.substr(0, colon)).c_str(), "%lld", &ts) == 1;
+            if (valid)
+                History.push_back({ts, std::string(token.substr(colon + 1))});
+        }
+        if (!valid)
+            break;
+        fs::path path = ConsumeToken(lv, true);
+        if (path.empty())
+            break;
+        return path.lexically_normal();
+    }
+    while (false);
+    throw std::runtime_error("unrecognized entry: " + line);
+}
+
+void CacheEntry::Save(std::ostream &fs, fs::path const &path) const
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%lld", (long long)Timestamp);
+    fs << buf << " " << Hash;
+    for (auto const &version : History)
+    {
+        std::snprintf(buf, sizeof(buf), "%lld", (long long)version.Timestamp);
+        fs << "," << buf << ":" << version.Hash;
+    }
+    fs << " " << path.lexically_normal() << "\n";
+}
+
+static bool SameStat(FileStat const &a, FileStat const &b) noexcept
+{
+    return a.MTimeSec == b.MTimeSec && a.MTimeNSec == b.MTimeNSec
+        && a.Size == b.Size && a.Inode == b.Inode;
+}
+
+bool SnapshotEntry::Matches(FileStat const &st) const noexcept
+{ return SameStat(Stat, st); }
+
+FileContent::FileContent(CacheEntry const &entry, SHA1::DigestType const *indexBlobId,
+    std::function<ContentHashes(bool withBlobId)> hash) :
+    indexBlobId(indexBlobId),
+    withBlobId(!indexBlobId && entry.HasBlobIds()),
+    hash(std::move(hash))
+{}
+
+ContentHashes const &FileContent::Hashes()
+{
+    if (!hashed)
+    {
+        hashes = hash(withBlobId);
+        hashed = true;
+    }
+    return hashes;
+}
+
+bool FileContent::Matches(std::string const &key)
+{
+    if (!CacheEntry::IsBlobId(key))
+        return Hashes().MD5 == key;
+    if (indexBlobId)
+        return std::string(*indexBlobId) == key;
+    return Hashes().BlobId == key;
+}
+
+std::string FileContent::Key(CacheEntry const &entry)
+{
+    if (indexBlobId && CacheEntry::IsBlobId(entry.Hash))
+        return *indexBlobId;
+    return Hashes().MD5;
+}
+
+fs::path SnapshotEntry::Load(std::istream &fs)
+{
+    // "1589730132 126981515 4096 1835523 git/libschmoo/schmoo.h"
+    std::string line = "<empty line>";
+    do
+    {
+        if (!std::getline(fs, line))
+            break;
+        auto lv = Trim(std::string_view(line));
+        long long mtime;
+        unsigned long long nsec, size, inode;
+        if (std::sscanf(ConsumeToken(lv).data(), "%lld", &mtime) != 1
+            || std::sscanf(ConsumeToken(lv).data(), "%llu", &nsec) != 1
+            || std::sscanf(ConsumeToken(lv).data(), "%llu", &size) != 1
+            || std::sscanf(ConsumeToken(lv).data(), "%llu", &inode) != 1)
+        {
+            break;
+        }
+        Stat.MTimeSec = mtime;
+        Stat.MTimeNSec = uint32_t(nsec);
+        Stat.Size = size;
+        Stat.Inode = inode;
+        fs::path path = ConsumeToken(lv, true);
+        if (path.empty())
+            break;
+        return path.lexically_normal();
+    }
+    while (false);
+    throw std::runtime_error("unrecognized snapshot entry: " + line);
+}
+
+void SnapshotEntry::Save(std::ostream &fs, fs::path const &path) const
+{
+    char buf[96];
+    std::snprintf(buf, sizeof(buf), "%lld %u %llu %llu", (long long)Stat.MTimeSec, Stat.MTimeNSec,
+        (unsigned long long)Stat.Size, (unsigned long long)Stat.Inode);
+    fs << buf << " " << path.lexically_normal() << "\n";
+}
+
+bool PartialHash::Matches(FileStat const &st) const noexcept
+{ return SameStat(Stat, st); }
+
+fs::path PartialHash::Load(std::istream &fs)
+{
+    // "1589730132 126981515 4096 1835523 2048 <md5 state> <blob state or -> git/libschmoo/schmoo.h"
+    std::string line = "<empty line>";
+    do
+    {
+        if (!std::getline(fs, line))
+            break;
+        auto lv = Trim(std::string_view(line));
+        long long mtime;
+        unsigned long long nsec, size, inode, offset;
+        if (std::sscanf(ConsumeToken(lv).data(), "%lld", &mtime) != 1
+            || std::sscanf(ConsumeToken(lv).data(), "%llu", &nsec) != 1
+            || std::sscanf(ConsumeToken(lv).data(), "%llu", &size) != 1
+            || std::sscanf(ConsumeToken(lv).data(), "%llu", &inode) != 1
+            || std::sscanf(ConsumeToken(lv).data(), "%llu", &offset) != 1)
+        {
+            break;
+        }
+        Stat.MTimeSec = mtime;
+        Stat.MTimeNSec = uint32_t(nsec);
+        Stat.Size = size;
+        Stat.Inode = inode;
+        Offset = offset;
+        MD5State = ConsumeToken(lv);
+        BlobState = ConsumeToken(lv);
+        if (MD5State.empty() || BlobState.empty())
+            break;
+        if (BlobState == "-")
+            BlobState.clear();
+        fs::path path = ConsumeToken(lv, true);
+        if (path.empty())
+            break;
+        return path.lexically_normal();
+    }
+    while (false);
+    throw std::runtime_error("unrecognized partial hash: " + line);
+}
+
+void PartialHash::Save(std::ostream &fs, fs::path const &path) const
+{
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "%lld %u %llu %llu %llu", (long long)Stat.MTimeSec, Stat.MTimeNSec,
+        (unsigned long long)Stat.Size, (unsigned long long)Stat.Inode, (unsigned long long)Offset);
+    fs << buf << " " << MD5State << " " << (BlobState.empty() ? "-" : BlobState)
+        << " " << path.lexically_normal() << "\n";
+}
+} // namespace GCache
@@ -0,0 +1,125 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#pragma once
+
+#include "Common/Config.hpp"
+#include "GCacheCore.hpp"
+#include "FileStat.hpp"
+#include "SHA1.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iostream> // std::istream, std::ostream
+#include <string>
+#include <vector>
+
+namespace GCache
+{
+// digests of working tree content, computed in a single read
+struct ContentHashes
+{
+    std::string BlobId; // empty unless requested
+    std::string MD5;
+};
+
+class FileContent;
+
+// line of .hash_cache.txt
+class GCACHECORE_API CacheEntry
+{
+public:
+    struct Version
+    {
+        int64_t Timestamp;
+        std::string Hash;
+    };
+
+    int64_t Timestamp = 0;
+    MSVC_WARN_PUSH_DISABLE(4251); // class needs to have dll-interface
+    std::string Hash;
+    // earlier contents of the file, most recent first
+    std::vector<Version> History;
+    MSVC_WARN_POP;
+    // set by Update for files present in the tree, not saved
+    bool Visited = false;
+
+    // entries seeded from git index keep blob IDs (40 hex digits), the rest
+    // keep MD5 digests
+    static bool IsBlobId(std::string const &hash) noexcept;
+
+    // true if Hash or any of History is a blob ID
+    bool HasBlobIds() const noexcept;
+    Version *FindVersion(FileContent &content);
+    // makes hash and timestamp current, keeping up to maxHistory earlier versions
+    void Push(std::string hash, int64_t ts, size_t maxHistory);
+    // throws std::runtime_error on malformed entry
+    std::filesystem::path Load(std::istream &fs);
+    void Save(std::ostream &fs, std::filesystem::path const &path) const;
+};
+
+// Current content of a file, hashed on first use. Stored keys are compared
+// by their own type, so an entry keyed by MD5 still finds history versions
+// seeded from git index and vice versa. indexBlobId is the blob ID from git
+// index if file stat still matches the index entry; hash(withBlobId) reads
+// the working tree once, hashing it with MD5 and, if requested, as a git
+// blob. Index blob IDs are computed from content after git filters (eol
+// conversion, LFS), so a working tree blob ID can only confirm them: on
+// mismatch the content is keyed by MD5, and the entry keeps MD5 from then on
+// instead of flipping between the two.
+class GCACHECORE_API FileContent
+{
+    SHA1::DigestType const *indexBlobId;
+    bool withBlobId;
+    bool hashed = false;
+    MSVC_WARN_PUSH_DISABLE(4251); // class needs to have dll-interface
+    std::function<ContentHashes(bool withBlobId)> hash;
+    ContentHashes hashes;
+    MSVC_WARN_POP;
+
+    ContentHashes const &Hashes();
+
+public:
+    FileContent(CacheEntry const &entry, SHA1::DigestType const *indexBlobId,
+        std::function<ContentHashes(bool withBlobId)> hash);
+
+    // true if key (blob ID or MD5) was computed from this content
+    bool Matches(std::string const &key);
+    // key to replace entry's Hash with: index blob ID for entries keyed by
+    // blob IDs while stat matches the index, MD5 otherwise
+    std::string Key(CacheEntry const &entry);
+};
+
+// line of .hash_snapshot.txt: stat data recorded by "gcache snapshot"
+// before a git operation
+class GCACHECORE_API SnapshotEntry
+{
+public:
+    FileStat Stat;
+
+    bool Matches(FileStat const &st) const noexcept;
+    // throws std::runtime_error on malformed entry
+    std::filesystem::path Load(std::istream &fs);
+    void Save(std::ostream &fs, std::filesystem::path const &path) const;
+};
+
+// .hash_partial.txt: hash of a file interrupted by time budget, resumed by
+// the next run unless the file has changed since
+class GCACHECORE_API PartialHash
+{
+public:
+    FileStat Stat;
+    // number of content bytes hashed so far
+    uint64_t Offset = 0;
+    MSVC_WARN_PUSH_DISABLE(4251); // class needs to have dll-interface
+    std::string MD5State;
+    // empty unless the blob ID was requested
+    std::string BlobState;
+    MSVC_WARN_POP;
+
+    bool Matches(FileStat const &st) const noexcept;
+    // throws std::runtime_error on malformed entry
+    std::filesystem::path Load(std::istream &fs);
+    void Save(std::ostream &fs, std::filesystem::path const &path) const;
+};
+} // namespace GCache
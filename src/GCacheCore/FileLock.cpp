@@ -0,0 +1,127 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#include "Common/Config.hpp"
+#include "FileLock.hpp"
+#include <stdexcept> // std::runtime_error
+
+#if defined(LINUX)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <cerrno>
+#elif defined(WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace GCache
+{
+#if defined(LINUX)
+
+FileLock::FileLock(std::filesystem::path const &path)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0)
+        throw std::runtime_error("can't open lock file: " + path.string());
+    handle = fd;
+}
+
+FileLock::~FileLock()
+{
+    Unlock();
+    close(int(handle));
+}
+
+void FileLock::Lock()
+{
+    while (flock(int(handle), LOCK_EX))
+    {
+        if (errno != EINTR)
+            throw std::runtime_error("can't lock file");
+    }
+    locked = true;
+}
+
+bool FileLock::TryLock()
+{
+    while (flock(int(handle), LOCK_EX | LOCK_NB))
+    {
+        if (errno == EWOULDBLOCK)
+            return false;
+        if (errno != EINTR)
+            throw std::runtime_error("can't lock file");
+    }
+    locked = true;
+    return true;
+}
+
+void FileLock::Unlock() noexcept
+{
+    if (!locked)
+        return;
+    flock(int(handle), LOCK_UN);
+    locked = false;
+}
+
+#elif defined(WINDOWS)
+
+// locked region lies far beyond the end of file, so that the file content
+// remains accessible through other handles
+static OVERLAPPED LockRegion()
+{
+    OVERLAPPED ov = {};
+    ov.Offset = 0xffffffff;
+    ov.OffsetHigh = 0x7fffffff;
+    return ov;
+}
+
+FileLock::FileLock(std::filesystem::path const &path)
+{
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("can't open lock file: " + path.string());
+    handle = intptr_t(h);
+}
+
+FileLock::~FileLock()
+{
+    Unlock();
+    CloseHandle(HANDLE(handle));
+}
+
+void FileLock::Lock()
+{
+    auto ov = LockRegion();
+    if (!LockFileEx(HANDLE(handle), LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &ov))
+        throw std::runtime_error("can't lock file");
+    locked = true;
+}
+
+bool FileLock::TryLock()
+{
+    auto ov = LockRegion();
+    if (!LockFileEx(HANDLE(handle), LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &ov))
+    {
+        if (GetLastError() == ERROR_LOCK_VIOLATION)
+            return false;
+        throw std::runtime_error("can't lock file");
+    }
+    locked = true;
+    return true;
+}
+
+void FileLock::Unlock() noexcept
+{
+    if (!locked)
+        return;
+    auto ov = LockRegion();
+    UnlockFileEx(HANDLE(handle), 0, 1, 0, &ov);
+    locked = false;
+}
+
+#endif
+} // namespace GCache
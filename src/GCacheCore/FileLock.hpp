@@ -0,0 +1,34 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#pragma once
+
+#include "Common/Config.hpp"
+#include "GCacheCore.hpp"
+#include <cstdint>
+#include <filesystem>
+
+namespace GCache
+{
+// Advisory exclusive lock on a file shared between processes. The lock is
+// released by Unlock, destructor, or when the process exits. Content of the
+// file isn't covered by the lock and can be accessed while it's held.
+class GCACHECORE_API FileLock
+{
+public:
+    // creates the file if needed, throws std::runtime_error on failure
+    FileLock(std::filesystem::path const &path);
+    ~FileLock();
+    FileLock(FileLock const &) = delete;
+    FileLock &operator=(FileLock const &) = delete;
+
+    void Lock();
+    bool TryLock();
+    void Unlock() noexcept;
+    bool Locked() const noexcept { return locked; }
+
+private:
+    intptr_t handle;
+    bool locked = false;
+};
+} // namespace GCache
@@ -0,0 +1,44 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#include "Common/Config.hpp"
+#include "FileStat.hpp"
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace GCache
+{
+#if defined(LINUX)
+
+bool FileStat::Read(std::filesystem::path const &path) noexcept
+{
+    struct stat st;
+    if (stat(path.c_str(), &st))
+        return false;
+    MTimeSec = st.st_mtim.tv_sec;
+    MTimeNSec = uint32_t(st.st_mtim.tv_nsec);
+    CTimeSec = st.st_ctim.tv_sec;
+    CTimeNSec = uint32_t(st.st_ctim.tv_nsec);
+    Inode = st.st_ino;
+    Size = st.st_size;
+    return true;
+}
+
+#elif defined(WINDOWS)
+
+bool FileStat::Read(std::filesystem::path const &path) noexcept
+{
+    struct _stat64 st;
+    if (_wstat64(path.c_str(), &st))
+        return false;
+    MTimeSec = st.st_mtime;
+    MTimeNSec = 0;
+    CTimeSec = st.st_ctime;
+    CTimeNSec = 0;
+    Inode = 0;
+    Size = st.st_size;
+    return true;
+}
+
+#endif
+} // namespace GCache
@@ -0,0 +1,27 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#pragma once
+
+#include "Common/Config.hpp"
+#include "GCacheCore.hpp"
+#include <cstdint>
+#include <filesystem>
+
+namespace GCache
+{
+// Subset of stat data that git keeps in its index. Fields not provided by
+// the platform are left zero.
+struct GCACHECORE_API FileStat
+{
+    int64_t MTimeSec = 0;
+    uint32_t MTimeNSec = 0;
+    int64_t CTimeSec = 0;
+    uint32_t CTimeNSec = 0;
+    uint64_t Inode = 0;
+    uint64_t Size = 0;
+
+    // returns false if the file doesn't exist or can't be accessed
+    bool Read(std::filesystem::path const &path) noexcept;
+};
+} // namespace GCache
@@ -0,0 +1,259 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#include "Common/Config.hpp"
+#include "GitIndex.hpp"
+#include <cstring>
+#include <fstream> // std::ifstream
+#include <iterator> // std::istreambuf_iterator
+#include <stdexcept> // std::runtime_error
+#include <vector>
+
+namespace GCache
+{
+namespace fs = std::filesystem;
+
+namespace
+{
+constexpr uint32_t HeaderSize = 12;
+constexpr uint32_t EntrySize = 62; // stat data, object ID and flags
+constexpr uint32_t IdSize = 20;
+constexpr uint16_t FlagAssumeValid = 0x8000;
+constexpr uint16_t FlagExtended = 0x4000;
+constexpr uint16_t FlagStageMask = 0x3000;
+constexpr uint16_t FlagNameMask = 0x0fff;
+constexpr uint16_t FlagSkipWorktree = 0x4000; // extended flags
+constexpr uint16_t FlagIntentToAdd = 0x2000; // extended flags
+constexpr uint32_t ModeTypeMask = 0170000;
+constexpr uint32_t ModeRegular = 0100000;
+
+class Reader
+{
+private:
+    uint8_t const *data;
+    size_t size;
+    size_t pos = 0;
+
+public:
+    Reader(std::vector<uint8_t> const &buf, size_t size) :
+        data(buf.data()), size(size)
+    {}
+
+    size_t Position() const noexcept { return pos; }
+
+    uint8_t const *Take(size_t n)
+    {
+        if (size - pos < n)
+            throw std::runtime_error("unexpected end of git index");
+        auto p = data + pos;
+        pos += n;
+        return p;
+    }
+
+    uint32_t U32()
+    {
+        auto p = Take(4);
+        return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+    }
+
+    uint16_t U16()
+    {
+        auto p = Take(2);
+        return uint16_t(p[0] << 8 | p[1]);
+    }
+
+    // variable-length integer used for path prefix compression in version 4
+    uint64_t VarInt()
+    {
+        uint8_t c = *Take(1);
+        uint64_t val = c & 127;
+        while (c & 128)
+        {
+            c = *Take(1);
+            val = ((val + 1) << 7) + (c & 127);
+        }
+        return val;
+    }
+
+    std::string_view CString()
+    {
+        auto p = data + pos;
+        auto end = static_cast<uint8_t const *>(std::memchr(p, 0, size - pos));
+        if (!end)
+            throw std::runtime_error("unterminated path in git index");
+        pos += end - p + 1;
+        return std::string_view(reinterpret_cast<char const *>(p), end - p);
+    }
+};
+} // namespace
+
+fs::path GitIndex::Locate(fs::path const &root)
+{
+    std::error_code ec;
+    auto dotGit = root / ".git";
+    if (fs::is_directory(dotGit, ec))
+        return fs::is_regular_file(dotGit / "index", ec) ? dotGit / "index" : fs::path();
+    if (!fs::is_regular_file(dotGit, ec))
+        return {};
+    // "gitdir: ../.git/worktrees/foo"
+    std::ifstream ifs(dotGit, std::ios::binary);
+    std::string line;
+    std::getline(ifs, line);
+    constexpr std::string_view prefix = "gitdir:";
+    if (line.compare(0, prefix.size(), prefix))
+        return {};
+    auto start = line.find_first_not_of(" \t", prefix.size());
+    if (start == std::string::npos)
+        return {};
+    auto gitDir = line.substr(start);
+    while (!gitDir.empty() && std::strchr("\r\n", gitDir.back()))
+        gitDir.pop_back();
+    fs::path path = gitDir;
+    if (path.is_relative())
+        path = root / path;
+    path /= "index";
+    return fs::is_regular_file(path, ec) ? path : fs::path();
+}
+
+uint32_t GitIndex::Count(fs::path const &path) noexcept
+{
+    if (path.empty())
+        return 0;
+    std::vector<uint8_t> buf(HeaderSize);
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.read(reinterpret_cast<char *>(buf.data()), HeaderSize))
+        return 0;
+    try
+    {
+        Reader r(buf, buf.size());
+        if (std::memcmp(r.Take(4), "DIRC", 4))
+            return 0;
+        r.U32(); // version
+        return r.U32();
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
+
+void GitIndex::Reset() noexcept
+{
+    entries.clear();
+    racySec = 0;
+    racyNSec = 0;
+}
+
+void GitIndex::Load(fs::path const &path)
+{
+    Reset();
+    FileStat indexStat;
+    if (!indexStat.Read(path))
+        throw std::runtime_error("can't read git index: " + path.string());
+    racySec = indexStat.MTimeSec;
+    racyNSec = indexStat.MTimeNSec;
+    std::vector<uint8_t> buf;
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        buf.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    if (buf.size() < HeaderSize + IdSize)
+        throw std::runtime_error("git index is truncated");
+    // trailing checksum is SHA-1 of everything before it, unless index.skipHash
+    // is set; a mismatch also rejects repositories using SHA-256 object IDs
+    auto contentSize = uint32_t(buf.size() - IdSize);
+    static uint8_t const skippedHash[IdSize] = {};
+    if (std::memcmp(buf.data() + contentSize, skippedHash, IdSize))
+    {
+        auto checksum = SHA1().Update(buf.data(), contentSize).Finalize().Digest();
+        if (std::memcmp(buf.data() + contentSize, checksum.Data, IdSize))
+            throw std::runtime_error("git index checksum mismatch");
+    }
+    Reader r(buf, contentSize);
+    if (std::memcmp(r.Take(4), "DIRC", 4))
+        throw std::runtime_error("bad git index signature");
+    auto version = r.U32();
+    if (version < 2 || version > 4)
+        throw std::runtime_error("unsupported git index version: " + std::to_string(version));
+    auto count = r.U32();
+    entries.reserve(count);
+    std::string name;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto start = r.Position();
+        Entry entry;
+        entry.Stat.CTimeSec = r.U32();
+        entry.Stat.CTimeNSec = r.U32();
+        entry.Stat.MTimeSec = r.U32();
+        entry.Stat.MTimeNSec = r.U32();
+        r.U32(); // dev
+        entry.Stat.Inode = r.U32();
+        auto mode = r.U32();
+        r.U32(); // uid
+        r.U32(); // gid
+        entry.Stat.Size = r.U32();
+        std::memcpy(entry.Id.Data, r.Take(IdSize), IdSize);
+        auto flags = r.U16();
+        uint16_t extFlags = 0;
+        if (flags & FlagExtended)
+        {
+            if (version < 3)
+                throw std::runtime_error("extended flags in git index version 2");
+            extFlags = r.U16();
+        }
+        if (version == 4)
+        {
+            auto strip = r.VarInt();
+            if (strip > name.size())
+                throw std::runtime_error("bad path prefix in git index");
+            name.resize(name.size() - strip);
+            name += r.CString();
+        }
+        else
+        {
+            name = r.CString();
+            // entries are padded with 1 to 8 zero bytes to a multiple of 8
+            auto entrySize = (r.Position() - 1 - start + 8) & ~size_t(7);
+            r.Take(entrySize - (r.Position() - start));
+        }
+        if ((flags & FlagNameMask) != FlagNameMask && (flags & FlagNameMask) != name.size())
+            throw std::runtime_error("path length mismatch in git index: " + name);
+        if (flags & (FlagAssumeValid | FlagStageMask))
+            continue;
+        if (extFlags & (FlagSkipWorktree | FlagIntentToAdd))
+            continue;
+        if ((mode & ModeTypeMask) != ModeRegular)
+            continue;
+        entries[fs::path(name).lexically_normal()] = entry;
+    }
+}
+
+GitIndex::Entry const *GitIndex::Find(fs::path const &path) const
+{
+    auto it = entries.find(path);
+    return it != entries.end() ? &it->second : nullptr;
+}
+
+SHA1::DigestType const *GitIndex::BlobId(fs::path const &path, FileStat const &st) const
+{
+    auto entry = Find(path);
+    if (!entry)
+        return nullptr;
+    auto const &ist = entry->Stat;
+    // index keeps the lower 32 bits of each field
+    if (ist.MTimeSec != uint32_t(st.MTimeSec) || ist.Size != uint32_t(st.Size))
+        return nullptr;
+    // fields the platform (or git build) doesn't record are left zero
+    if (ist.MTimeNSec && ist.MTimeNSec != st.MTimeNSec)
+        return nullptr;
+    if (ist.CTimeSec && ist.CTimeSec != uint32_t(st.CTimeSec))
+        return nullptr;
+    if (ist.CTimeNSec && ist.CTimeNSec != st.CTimeNSec)
+        return nullptr;
+    if (ist.Inode && ist.Inode != uint32_t(st.Inode))
+        return nullptr;
+    if (st.MTimeSec > racySec || (st.MTimeSec == racySec && st.MTimeNSec >= racyNSec))
+        return nullptr;
+    return &entry->Id;
+}
+} // namespace GCache
@@ -0,0 +1,61 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#pragma once
+
+#include "Common/Config.hpp"
+#include "GCacheCore.hpp"
+#include "FileStat.hpp"
+#include "SHA1.hpp"
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+namespace GCache
+{
+// Read-only view of a git index file (versions 2 to 4). Only stage 0
+// regular file entries are kept: gitlinks, symlinks, sparse directories,
+// conflicts and skip-worktree/intent-to-add/assume-valid entries are dropped.
+class GCACHECORE_API GitIndex
+{
+public:
+    struct Entry
+    {
+        FileStat Stat;
+        SHA1::DigestType Id;
+    };
+
+    // locates the index of the repository at root, following the "gitdir:"
+    // link used by worktrees and submodules; returns empty path if not found
+    static std::filesystem::path Locate(std::filesystem::path const &root);
+
+    // number of entries from index header without loading the index,
+    // zero if it can't be read
+    static uint32_t Count(std::filesystem::path const &path) noexcept;
+
+    // throws std::runtime_error on malformed or unsupported index
+    void Load(std::filesystem::path const &path);
+    void Reset() noexcept;
+    size_t Size() const noexcept { return entries.size(); }
+    Entry const *Find(std::filesystem::path const &path) const;
+    // returns blob ID recorded for path if the stat data still matches
+    // the index entry, which means that git considers the file unmodified
+    SHA1::DigestType const *BlobId(std::filesystem::path const &path, FileStat const &st) const;
+
+private:
+    struct PathHasher
+    {
+    public:
+        size_t operator()(std::filesystem::path const &p) const
+        { return std::filesystem::hash_value(p); }
+    };
+
+    MSVC_WARN_PUSH_DISABLE(4251); // class needs to have dll-interface
+    std::unordered_map<std::filesystem::path, Entry, PathHasher> entries;
+    MSVC_WARN_POP;
+    // entries modified at or after this moment are "racily clean": their
+    // stat data may match even though content has changed
+    int64_t racySec = 0;
+    uint32_t racyNSec = 0;
+};
+} // namespace GCache
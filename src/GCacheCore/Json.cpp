@@ -0,0 +1,35 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#include "Common/Config.hpp"
+#include "Json.hpp"
+#include <cstdint>
+#include <cstdio> // std::snprintf
+
+namespace GCache
+{
+std::string JsonString(std::string_view s)
+{
+    std::string result;
+    result.reserve(s.size() + 2);
+    result += '"';
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (uint8_t(c) < 0x20)
+        {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            result += buf;
+        }
+        else
+            result += c;
+    }
+    result += '"';
+    return result;
+}
+} // namespace GCache
@@ -0,0 +1,15 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#pragma once
+
+#include "Common/Config.hpp"
+#include "GCacheCore.hpp"
+#include <string>
+#include <string_view>
+
+namespace GCache
+{
+// returns s as a quoted JSON string literal; s is expected to be UTF-8
+GCACHECORE_API std::string JsonString(std::string_view s);
+} // namespace GCache
@@ -5,6 +5,7 @@
 #include "Common/Config.hpp"
 #include "MD5.hpp"
 #include <cstring>
+#include <cstdio> // std::snprintf, std::sscanf
 
 namespace GCache
 {
@@ -242,6 +243,48 @@ MD5 &MD5::Finalize() noexcept
     return *this;
 }
 
+// "<count><state><buffered bytes>", 32-bit words as 8 hex digits each
+std::string MD5::SaveState() const
+{
+    char buf[6*8 + 2*BlockSize + 1];
+    int len = std::snprintf(buf, sizeof(buf), "%08x%08x%08x%08x%08x%08x", unsigned(count[0]),
+        unsigned(count[1]), unsigned(state[0]), unsigned(state[1]), unsigned(state[2]), unsigned(state[3]));
+    uint32_t index = count[0]/8 % BlockSize;
+    for (uint32_t i = 0; i < index; i++)
+        std::snprintf(buf+len+i*2, sizeof(buf)-len-i*2, "%02x", buffer[i]);
+    return std::string(buf, len + index*2);
+}
+
+bool MD5::LoadState(std::string const &hexState) noexcept
+{
+    unsigned words[6];
+    if (hexState.size() < sizeof(words)*2)
+        return false;
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        if (std::sscanf(hexState.c_str() + i*8, "%8x", &words[i]) != 1)
+            return false;
+    }
+    uint32_t index = words[0]/8 % BlockSize;
+    if (hexState.size() != sizeof(words)*2 + index*2)
+        return false;
+    uint8_t bytes[BlockSize];
+    for (uint32_t i = 0; i < index; i++)
+    {
+        unsigned byte;
+        if (std::sscanf(hexState.c_str() + sizeof(words)*2 + i*2, "%2x", &byte) != 1)
+            return false;
+        bytes[i] = uint8_t(byte);
+    }
+    count[0] = words[0];
+    count[1] = words[1];
+    for (uint32_t i = 0; i < 4; i++)
+        state[i] = words[2+i];
+    std::memcpy(buffer, bytes, index);
+    finalized = false;
+    return true;
+}
+
 MD5::DigestType::operator std::string() const
 {
     char buf[2*sizeof(Data)+1];
@@ -32,6 +32,10 @@ public:
     MD5 &Update(std::istream &src);
     MD5 &Finalize() noexcept;
     DigestType Digest() const noexcept { return digest; }
+    // intermediate state of unfinalized hash as hex digits, to resume later
+    std::string SaveState() const;
+    // returns false and keeps current state if the string is malformed
+    bool LoadState(std::string const &hexState) noexcept;
 
 private:
     static constexpr uint32_t BlockSize = 64;
@@ -0,0 +1,59 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#include "Common/Config.hpp"
+#include "Manifest.hpp"
+#include "Json.hpp"
+#include <algorithm> // std::sort
+#include <fstream> // std::ofstream
+#include <stdexcept> // std::runtime_error
+
+namespace GCache
+{
+void Manifest::Add(Change change, std::filesystem::path const &path)
+{ entries.emplace_back(change, path.generic_u8string()); }
+
+void Manifest::Save(std::filesystem::path const &path, Format format) const
+{
+    auto sorted = entries;
+    std::sort(sorted.begin(), sorted.end(),
+        [](auto const &a, auto const &b) { return a.second < b.second; });
+    std::ofstream ofs(path, std::ios::binary);
+    if (!ofs)
+        throw std::runtime_error("can't write manifest: " + path.string());
+    if (format == Format::Nul)
+    {
+        for (auto const &[change, name] : sorted)
+            ofs << char(change) << '\0' << name << '\0';
+    }
+    else
+    {
+        std::pair<Change, char const *> const groups[] =
+        {
+            {Change::Modified, "modified"},
+            {Change::Added, "added"},
+            {Change::Deleted, "deleted"},
+        };
+        char const *groupSeparator = "{";
+        for (auto const &[group, key] : groups)
+        {
+            ofs << groupSeparator << "\n  \"" << key << "\": [";
+            groupSeparator = ",";
+            char const *separator = "\n    ";
+            bool empty = true;
+            for (auto const &[change, name] : sorted)
+            {
+                if (change != group)
+                    continue;
+                ofs << separator << JsonString(name);
+                separator = ",\n    ";
+                empty = false;
+            }
+            ofs << (empty ? "]" : "\n  ]");
+        }
+        ofs << "\n}\n";
+    }
+    if (!ofs.flush())
+        throw std::runtime_error("can't write manifest: " + path.string());
+}
+} // namespace GCache
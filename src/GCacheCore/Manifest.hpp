@@ -0,0 +1,46 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#pragma once
+
+#include "Common/Config.hpp"
+#include "GCacheCore.hpp"
+#include <filesystem>
+#include <string>
+#include <utility> // std::pair
+#include <vector>
+
+namespace GCache
+{
+// List of files which content actually changed, for build systems to limit
+// their dependency scanning to. Paths are written with forward slashes.
+class GCACHECORE_API Manifest
+{
+public:
+    enum class Change : char
+    {
+        Modified = 'M',
+        Added = 'A',
+        Deleted = 'D',
+    };
+
+    enum class Format
+    {
+        // "M\0path\0A\0path\0...", same as git diff --name-status -z
+        Nul,
+        // {"modified": [...], "added": [...], "deleted": [...]}
+        Json,
+    };
+
+    void Add(Change change, std::filesystem::path const &path);
+    void Reset() noexcept { entries.clear(); }
+    size_t Size() const noexcept { return entries.size(); }
+    // throws std::runtime_error on failure
+    void Save(std::filesystem::path const &path, Format format) const;
+
+private:
+    MSVC_WARN_PUSH_DISABLE(4251); // class needs to have dll-interface
+    std::vector<std::pair<Change, std::string>> entries;
+    MSVC_WARN_POP;
+};
+} // namespace GCache
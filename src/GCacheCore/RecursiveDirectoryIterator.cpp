@@ -3,6 +3,8 @@
 
 #include "Common/Config.hpp"
 #include "RecursiveDirectoryIterator.hpp"
+#include "Trace.hpp"
+#include <optional>
 
 namespace GCache
 {
@@ -20,12 +22,20 @@ bool RecursiveDirectoryIterator::Directory() const
 void RecursiveDirectoryIterator::Skip() noexcept
 { impl.disable_recursion_pending(); }
 
-RecursiveDirectoryIterator::RecursiveDirectoryIterator(fs::path path) :
-    impl(path)
-{}
+RecursiveDirectoryIterator::RecursiveDirectoryIterator(fs::path path)
+{
+    Trace::Scope scope("RecursiveDirectoryIterator::OpenDirectory", path);
+    impl = fs::recursive_directory_iterator(path);
+}
 
 RecursiveDirectoryIterator &RecursiveDirectoryIterator::operator++()
 {
+    // descending into a directory opens it and reads its first entry, the
+    // rest is read lazily by the following increments; symlinks to
+    // directories aren't followed
+    std::optional<Trace::Scope> scope;
+    if (Trace::Enabled() && impl.recursion_pending() && fs::is_directory(impl->symlink_status()))
+        scope.emplace("RecursiveDirectoryIterator::OpenDirectory", impl->path());
     ++impl;
     return *this;
 }
@@ -0,0 +1,210 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+// Derived from FIPS 180-1 Secure Hash Standard
+
+#include "Common/Config.hpp"
+#include "SHA1.hpp"
+#include "MD5.hpp" // Detail::RotateLeft
+#include <cstring>
+#include <cstdio> // std::snprintf, std::sscanf
+
+namespace GCache
+{
+void SHA1::Init() noexcept
+{
+    finalized = false;
+    count = 0;
+    state[0] = 0x67452301;
+    state[1] = 0xefcdab89;
+    state[2] = 0x98badcfe;
+    state[3] = 0x10325476;
+    state[4] = 0xc3d2e1f0;
+}
+
+void SHA1::TransformBlock(uint8_t const block[BlockSize]) noexcept
+{
+    using Detail::RotateLeft;
+    uint32_t w[80];
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t(block[i*4]) << 24)
+            | (uint32_t(block[i*4+1]) << 16)
+            | (uint32_t(block[i*4+2]) << 8)
+            | uint32_t(block[i*4+3]);
+    }
+    for (uint32_t i = 16; i < 80; i++)
+        w[i] = RotateLeft(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (uint32_t i = 0; i < 80; i++)
+    {
+        uint32_t f, k;
+        if (i < 20)
+        {
+            f = (b&c) | (~b&d);
+            k = 0x5a827999;
+        }
+        else if (i < 40)
+        {
+            f = b^c^d;
+            k = 0x6ed9eba1;
+        }
+        else if (i < 60)
+        {
+            f = (b&c) | (b&d) | (c&d);
+            k = 0x8f1bbcdc;
+        }
+        else
+        {
+            f = b^c^d;
+            k = 0xca62c1d6;
+        }
+        uint32_t t = RotateLeft(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = RotateLeft(b, 30);
+        b = a;
+        a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    // Zeroize sensitive information.
+    std::memset(w, 0, sizeof(w));
+}
+
+SHA1 &SHA1::Update(uint8_t const input[], uint32_t length) noexcept
+{
+    uint32_t index = uint32_t(count % BlockSize);
+    count += length;
+    // number of bytes we need to fill in buffer
+    uint32_t firstPart = BlockSize-index;
+    uint32_t i = 0;
+    // transform as many times as possible.
+    if (length >= firstPart)
+    {
+        std::memcpy(buffer+index, input, firstPart);
+        TransformBlock(buffer);
+        for (i = firstPart; i+BlockSize <= length; i += BlockSize)
+            TransformBlock(input+i);
+        index = 0;
+    }
+    // buffer remaining input
+    std::memcpy(buffer+index, input+i, length-i);
+    return *this;
+}
+
+SHA1 &SHA1::Update(const char input[], uint32_t length) noexcept
+{ return Update((uint8_t const *)input, length); }
+
+SHA1 &SHA1::Update(std::istream &src)
+{
+    char buf[BlockSize];
+    while (true)
+    {
+        src.read(buf, BlockSize);
+        auto rsize = src.gcount();
+        if (!rsize)
+            break;
+        Update(buf, int32_t(rsize));
+    }
+    return *this;
+}
+
+SHA1 &SHA1::Finalize() noexcept
+{
+    static uint8_t const padding[64] = {0x80};
+    if (!finalized)
+    {
+        // Save number of bits, big-endian
+        uint8_t bits[8];
+        uint64_t bitCount = count << 3;
+        for (uint32_t i = 0; i < 8; i++)
+            bits[i] = uint8_t(bitCount >> (56 - i*8));
+        // pad out to 56 mod 64.
+        uint32_t index = uint32_t(count % 64);
+        uint32_t padLen = index < 56 ? 56-index : 120-index;
+        Update(padding, padLen);
+        // Append length (before padding)
+        Update(bits, 8);
+        // Store state in digest
+        for (uint32_t i = 0; i < 20; i++)
+            digest.Data[i] = uint8_t(state[i/4] >> (24 - (i%4)*8));
+        // Zeroize sensitive information.
+        std::memset(buffer, 0, sizeof(buffer));
+        count = 0;
+        finalized = true;
+    }
+    return *this;
+}
+
+SHA1 SHA1::GitBlob(uint64_t size) noexcept
+{
+    char header[32];
+    int len = std::snprintf(header, sizeof(header), "blob %llu", (unsigned long long)size);
+    SHA1 sha1;
+    // header includes the terminating zero
+    sha1.Update(header, uint32_t(len+1));
+    return sha1;
+}
+
+SHA1::DigestType SHA1::GitBlobId(std::istream &src, uint64_t size)
+{ return GitBlob(size).Update(src).Finalize().Digest(); }
+
+// "<count><state><buffered bytes>", byte count as 16 hex digits, 32-bit
+// words as 8 hex digits each
+std::string SHA1::SaveState() const
+{
+    char buf[16 + 5*8 + 2*BlockSize + 1];
+    int len = std::snprintf(buf, sizeof(buf), "%016llx%08x%08x%08x%08x%08x", (unsigned long long)count,
+        unsigned(state[0]), unsigned(state[1]), unsigned(state[2]), unsigned(state[3]), unsigned(state[4]));
+    uint32_t index = uint32_t(count % BlockSize);
+    for (uint32_t i = 0; i < index; i++)
+        std::snprintf(buf+len+i*2, sizeof(buf)-len-i*2, "%02x", buffer[i]);
+    return std::string(buf, len + index*2);
+}
+
+bool SHA1::LoadState(std::string const &hexState) noexcept
+{
+    constexpr uint32_t headerLen = 16 + 5*8;
+    unsigned long long bytesHashed;
+    unsigned words[5];
+    if (hexState.size() < headerLen
+        || std::sscanf(hexState.c_str(), "%16llx", &bytesHashed) != 1)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        if (std::sscanf(hexState.c_str() + 16 + i*8, "%8x", &words[i]) != 1)
+            return false;
+    }
+    uint32_t index = uint32_t(bytesHashed % BlockSize);
+    if (hexState.size() != headerLen + index*2)
+        return false;
+    uint8_t bytes[BlockSize];
+    for (uint32_t i = 0; i < index; i++)
+    {
+        unsigned byte;
+        if (std::sscanf(hexState.c_str() + headerLen + i*2, "%2x", &byte) != 1)
+            return false;
+        bytes[i] = uint8_t(byte);
+    }
+    count = bytesHashed;
+    for (uint32_t i = 0; i < 5; i++)
+        state[i] = words[i];
+    std::memcpy(buffer, bytes, index);
+    finalized = false;
+    return true;
+}
+
+SHA1::DigestType::operator std::string() const
+{
+    char buf[2*sizeof(Data)+1];
+    for (uint32_t i = 0; i < sizeof(Data); i++)
+        std::snprintf(buf+i*2, sizeof(buf)-i*2, "%02x", Data[i]);
+    buf[2*sizeof(Data)] = 0;
+    return std::string(buf);
+}
+} // namespace GCache
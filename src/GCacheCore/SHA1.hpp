@@ -0,0 +1,52 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#pragma once
+
+#include "Common/Config.hpp"
+#include "GCacheCore.hpp"
+#include <cstdint>
+#include <string>
+#include <iostream> // std::istream
+
+namespace GCache
+{
+class GCACHECORE_API SHA1
+{
+public:
+    struct GCACHECORE_API DigestType
+    {
+    public:
+        uint8_t Data[20] = {};
+        operator std::string() const;
+    };
+
+    SHA1() noexcept { Init(); }
+    SHA1 &Update(uint8_t const buf[], uint32_t length) noexcept;
+    SHA1 &Update(char const buf[], uint32_t length) noexcept;
+    SHA1 &Update(std::istream &src);
+    SHA1 &Finalize() noexcept;
+    DigestType Digest() const noexcept { return digest; }
+    // intermediate state of unfinalized hash as hex digits, to resume later
+    std::string SaveState() const;
+    // returns false and keeps current state if the string is malformed
+    bool LoadState(std::string const &hexState) noexcept;
+
+    // git object ID of a blob: SHA-1 over "blob <size>\0" followed by the content
+    static DigestType GitBlobId(std::istream &src, uint64_t size);
+    // returns SHA1 primed with the blob header, content is to be fed by caller
+    static SHA1 GitBlob(uint64_t size) noexcept;
+
+private:
+    static constexpr uint32_t BlockSize = 64;
+
+    void Init() noexcept;
+    void TransformBlock(uint8_t const block[BlockSize]) noexcept;
+
+    bool finalized;
+    uint8_t buffer[BlockSize];
+    uint64_t count; // in bytes
+    uint32_t state[5];
+    DigestType digest;
+};
+} // namespace GCache
@@ -1,10 +1,21 @@
 #include "Common/Config.hpp"
 #include "GCacheCore.hpp"
 #include "MD5.hpp"
+#include "SHA1.hpp"
+#include "FileStat.hpp"
+#include "GitIndex.hpp"
+#include "Trace.hpp"
+#include "FileLock.hpp"
+#include "Json.hpp"
+#include "Manifest.hpp"
+#include "CacheEntry.hpp"
 #include "RecursiveDirectoryIterator.hpp"
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
+#include <chrono>
 #include <filesystem>
+#include <sstream>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -44,8 +55,492 @@ TEST_CASE("MD5 Init & Update & Finalize")
     }
 }
 
+TEST_CASE("SHA1 Init & Update & Finalize")
+{
+    auto sha1 = [](char const *s)
+    { return std::string(SHA1().Update(s, std::strlen(s)).Finalize().Digest()); };
+    SUBCASE("empty string")
+    {
+        CHECK(sha1("") == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    }
+    SUBCASE("lazy dog")
+    {
+        CHECK(sha1("The quick brown fox jumps over the lazy dog") == "2fd4e1c67a2d28fced849ee1bb76e7391b93eb12");
+    }
+    SUBCASE("two blocks")
+    {
+        CHECK(sha1("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")
+            == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+    }
+}
+
+TEST_CASE("SHA1::GitBlobId")
+{
+    auto blobId = [](std::string const &s)
+    {
+        std::istringstream iss(s);
+        return std::string(SHA1::GitBlobId(iss, s.size()));
+    };
+    CHECK(blobId("") == "e69de29bb2d1d6434b8b29ae775ad8c2e48c5391");
+    CHECK(blobId("hello\n") == "ce013625030ba8dba906f756967f9e9ca394464a");
+}
+
+TEST_CASE("SaveState & LoadState")
+{
+    std::string text(1000, 'x');
+    for (size_t i = 0; i < text.size(); i++)
+        text[i] = char('a' + i % 26);
+    // split mid-block, so that saved state includes buffered bytes
+    uint32_t split = 100;
+    SUBCASE("MD5")
+    {
+        MD5 head;
+        head.Update(text.data(), split);
+        MD5 resumed;
+        REQUIRE(resumed.LoadState(head.SaveState()));
+        resumed.Update(text.data() + split, uint32_t(text.size() - split));
+        CHECK(std::string(resumed.Finalize().Digest())
+            == std::string(MD5().Update(text.data(), uint32_t(text.size())).Finalize().Digest()));
+        MD5 md5;
+        CHECK(!md5.LoadState(""));
+        CHECK(!md5.LoadState(head.SaveState() + "00"));
+        CHECK(!md5.LoadState(head.SaveState().substr(2)));
+    }
+    SUBCASE("SHA1")
+    {
+        auto head = SHA1::GitBlob(text.size());
+        head.Update(text.data(), split);
+        SHA1 resumed;
+        REQUIRE(resumed.LoadState(head.SaveState()));
+        resumed.Update(text.data() + split, uint32_t(text.size() - split));
+        std::istringstream iss(text);
+        CHECK(std::string(resumed.Finalize().Digest()) == std::string(SHA1::GitBlobId(iss, text.size())));
+        SHA1 sha1;
+        CHECK(!sha1.LoadState("zz"));
+        CHECK(!sha1.LoadState(head.SaveState() + "00"));
+    }
+}
+
 namespace fs = std::filesystem;
 
+TEST_CASE("GitIndex")
+{
+    fs::path root = "test_git_index";
+    fs::remove_all(root);
+    fs::create_directories(root / ".git");
+    fs::create_directories(root / "src");
+    auto touch = [](fs::path const &path, char const *data)
+    { std::ofstream(path, std::ios::binary) << data; };
+    touch(root / "src/a.txt", "hello\n");
+    touch(root / "b.txt", "world\n");
+    FileStat stA, stB;
+    REQUIRE(stA.Read(root / "src/a.txt"));
+    REQUIRE(stB.Read(root / "b.txt"));
+    std::string buf;
+    auto u32 = [&](uint64_t v)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            buf += char((v >> shift) & 0xff);
+    };
+    auto entry = [&](FileStat const &st, uint32_t mode, uint16_t stage, char const *id, std::string const &name)
+    {
+        auto start = buf.size();
+        u32(st.CTimeSec);
+        u32(st.CTimeNSec);
+        u32(st.MTimeSec);
+        u32(st.MTimeNSec);
+        u32(0); // dev
+        u32(st.Inode);
+        u32(mode);
+        u32(0); // uid
+        u32(0); // gid
+        u32(st.Size);
+        for (int i = 0; i < 20; i++)
+            buf += char(std::stoi(std::string(id + i*2, 2), nullptr, 16));
+        auto flags = uint16_t(stage << 12 | name.size());
+        buf += char(flags >> 8);
+        buf += char(flags & 0xff);
+        buf += name;
+        buf.append(((buf.size() - start + 8) & ~size_t(7)) - (buf.size() - start), '\0');
+    };
+    buf = "DIRC";
+    u32(2);
+    u32(4);
+    entry(stB, 0100644, 0, "cc628ccd10742baea8241c5924df992b5c019f71", "b.txt");
+    entry(stB, 0120000, 0, "cc628ccd10742baea8241c5924df992b5c019f71", "link");
+    entry(stA, 0100644, 0, "ce013625030ba8dba906f756967f9e9ca394464a", "src/a.txt");
+    entry(stA, 0100644, 2, "ce013625030ba8dba906f756967f9e9ca394464a", "src/conflict.txt");
+    auto checksum = SHA1().Update(buf.data(), uint32_t(buf.size())).Finalize().Digest();
+    buf.append(reinterpret_cast<char const *>(checksum.Data), sizeof(checksum.Data));
+    auto indexPath = root / ".git/index";
+    std::ofstream(indexPath, std::ios::binary) << buf;
+    // stat data of the fixtures must predate the index to be trusted
+    fs::last_write_time(indexPath, fs::last_write_time(indexPath) + std::chrono::seconds(2));
+    CHECK(GitIndex::Locate(root) == indexPath);
+    CHECK(GitIndex::Count(indexPath) == 4);
+    CHECK(GitIndex::Count(root / "missing") == 0);
+    GitIndex index;
+    index.Load(indexPath);
+    CHECK(index.Size() == 2);
+    CHECK(!index.Find("link"));
+    CHECK(!index.Find("src/conflict.txt"));
+    auto id = index.BlobId("src/a.txt", stA);
+    REQUIRE(id);
+    CHECK(std::string(*id) == "ce013625030ba8dba906f756967f9e9ca394464a");
+    FileStat changed = stB;
+    changed.Size++;
+    CHECK(index.BlobId("b.txt", stB));
+    CHECK(!index.BlobId("b.txt", changed));
+    buf[buf.size() - 1] ^= 1;
+    std::ofstream(indexPath, std::ios::binary) << buf;
+    CHECK_THROWS(index.Load(indexPath));
+    fs::remove_all(root);
+}
+
+TEST_CASE("Trace")
+{
+    fs::path path = "test_trace.json";
+    CHECK(!Trace::Enabled());
+    {
+        Trace::Scope scope("disabled");
+    }
+    Trace::Enable();
+    REQUIRE(Trace::Enabled());
+    {
+        Trace::Scope scope("main", "dir/\"file\".txt");
+        scope.Bytes(42);
+    }
+    std::thread([]
+    { Trace::Scope scope("worker"); }).join();
+    Trace::Save(path);
+    std::ifstream ifs(path);
+    std::string json((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ifs.close();
+    CHECK(json.find("\"disabled\"") == std::string::npos);
+    CHECK(json.find("\"name\":\"main\",\"ph\":\"X\",\"pid\":1,\"tid\":1,") != std::string::npos);
+    CHECK(json.find("\"args\":{\"path\":\"dir/\\\"file\\\".txt\",\"bytes\":42}") != std::string::npos);
+    CHECK(json.find("\"name\":\"worker\",\"ph\":\"X\",\"pid\":1,\"tid\":2,") != std::string::npos);
+    fs::remove(path);
+}
+
+TEST_CASE("FileLock")
+{
+    fs::path path = "test_lock";
+    fs::remove(path);
+    {
+        FileLock first(path), second(path);
+        CHECK(fs::exists(path));
+        CHECK(first.TryLock());
+        CHECK(first.Locked());
+        CHECK(!second.TryLock());
+        first.Unlock();
+        CHECK(!first.Locked());
+        CHECK(second.TryLock());
+        std::ofstream(path) << "content isn't locked";
+    }
+    FileLock third(path);
+    CHECK(third.TryLock());
+    third.Unlock();
+    fs::remove(path);
+}
+
+TEST_CASE("JsonString")
+{
+    CHECK(JsonString("") == "\"\"");
+    CHECK(JsonString("a/b.txt") == "\"a/b.txt\"");
+    CHECK(JsonString("q\"b\\") == "\"q\\\"b\\\\\"");
+    CHECK(JsonString("\n\x01") == "\"\\u000a\\u0001\"");
+}
+
+TEST_CASE("Manifest")
+{
+    fs::path path = "test_manifest";
+    Manifest manifest;
+    manifest.Add(Manifest::Change::Modified, fs::path("src") / "b.cpp");
+    manifest.Add(Manifest::Change::Deleted, "c.h");
+    manifest.Add(Manifest::Change::Modified, "a.cpp");
+    CHECK(manifest.Size() == 3);
+    auto read = [&]
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    };
+    SUBCASE("nul")
+    {
+        manifest.Save(path, Manifest::Format::Nul);
+        CHECK(read() == std::string("M\0a.cpp\0D\0c.h\0M\0src/b.cpp\0", 26));
+    }
+    SUBCASE("json")
+    {
+        manifest.Save(path, Manifest::Format::Json);
+        CHECK(read() ==
+            "{\n"
+            "  \"modified\": [\n"
+            "    \"a.cpp\",\n"
+            "    \"src/b.cpp\"\n"
+            "  ],\n"
+            "  \"added\": [],\n"
+            "  \"deleted\": [\n"
+            "    \"c.h\"\n"
+            "  ]\n"
+            "}\n");
+    }
+    fs::remove(path);
+}
+
+TEST_CASE("CacheEntry Load & Save")
+{
+    auto load = [](std::string const &line)
+    {
+        std::istringstream iss(line);
+        CacheEntry entry;
+        auto path = entry.Load(iss);
+        return std::make_pair(path, entry);
+    };
+    SUBCASE("without history")
+    {
+        auto [path, entry] = load("-4645252017819896642 9e107d9d372bb6826bd81d3542a419d6 \"dir/file name.txt\"\n");
+        CHECK(path == fs::path("dir") / "file name.txt");
+        CHECK(entry.Timestamp == -4645252017819896642);
+        CHECK(entry.Hash == "9e107d9d372bb6826bd81d3542a419d6");
+        CHECK(entry.History.empty());
+        CHECK(!CacheEntry::IsBlobId(entry.Hash));
+    }
+    SUBCASE("round trip with history")
+    {
+        CacheEntry entry;
+        entry.Timestamp = 30;
+        entry.Hash = "ce013625030ba8dba906f756967f9e9ca394464a";
+        entry.History = {{-20, "aa"}, {10, "bb"}};
+        std::ostringstream oss;
+        entry.Save(oss, "a.txt");
+        CHECK(oss.str() == "30 ce013625030ba8dba906f756967f9e9ca394464a,-20:aa,10:bb \"a.txt\"\n");
+        auto [path, loaded] = load(oss.str());
+        CHECK(path == "a.txt");
+        CHECK(loaded.Timestamp == 30);
+        CHECK(loaded.Hash == entry.Hash);
+        CHECK(CacheEntry::IsBlobId(loaded.Hash));
+        REQUIRE(loaded.History.size() == 2);
+        CHECK(loaded.History[0].Timestamp == -20);
+        CHECK(loaded.History[0].Hash == "aa");
+        CHECK(loaded.History[1].Timestamp == 10);
+        CHECK(loaded.History[1].Hash == "bb");
+    }
+    SUBCASE("malformed")
+    {
+        CHECK_THROWS(load(""));
+        CHECK_THROWS(load("x aa \"a.txt\""));
+        CHECK_THROWS(load("1 aa"));
+        CHECK_THROWS(load("1 aa, \"a.txt\""));
+        CHECK_THROWS(load("1 aa,2 \"a.txt\""));
+        CHECK_THROWS(load("1 aa,2: \"a.txt\""));
+        CHECK_THROWS(load("1 aa,x:bb \"a.txt\""));
+        CHECK_THROWS(load("1 aa,2:bb, \"a.txt\""));
+    }
+}
+
+TEST_CASE("FileContent")
+{
+    auto md5 = [](std::string const &s)
+    { return std::string(MD5().Update(s.data(), uint32_t(s.size())).Finalize().Digest()); };
+    auto blob = [](std::string const &s)
+    {
+        std::istringstream iss(s);
+        return std::string(SHA1::GitBlobId(iss, s.size()));
+    };
+    std::string content;
+    int reads = 0;
+    auto hash = [&](bool withBlobId)
+    {
+        reads++;
+        return ContentHashes{withBlobId ? blob(content) : std::string(), md5(content)};
+    };
+    SUBCASE("stat matches index")
+    {
+        CacheEntry entry;
+        std::istringstream iss("line\n");
+        auto indexId = SHA1::GitBlobId(iss, 5);
+        entry.Hash = indexId;
+        FileContent current(entry, &indexId, hash);
+        CHECK(current.Matches(entry.Hash));
+        CHECK(current.Key(entry) == entry.Hash);
+        CHECK(reads == 0);
+    }
+    SUBCASE("unfiltered file")
+    {
+        CacheEntry entry;
+        entry.Hash = blob("line\n");
+        content = "line\n";
+        CHECK(FileContent(entry, nullptr, hash).Matches(entry.Hash));
+        CHECK(reads == 1);
+    }
+    SUBCASE("filtered file")
+    {
+        // seeded from index blob of normalized content, working tree has CRLF
+        CacheEntry entry;
+        std::istringstream iss("line\n");
+        auto indexId = SHA1::GitBlobId(iss, 5);
+        entry.Hash = indexId;
+        content = "line\r\n";
+        // stat no longer matches index: falls back to MD5, reported as updated once
+        FileContent current(entry, nullptr, hash);
+        CHECK(!current.Matches(entry.Hash));
+        auto key = current.Key(entry);
+        CHECK(key == md5(content));
+        CHECK(!CacheEntry::IsBlobId(key));
+        CHECK(reads == 1);
+        entry.Push(key, 2, 0);
+        // touched again
+        CHECK(FileContent(entry, nullptr, hash).Matches(entry.Hash));
+        // checked out again with identical content, stat matches index
+        CHECK(FileContent(entry, &indexId, hash).Matches(entry.Hash));
+    }
+    SUBCASE("md5 entry")
+    {
+        CacheEntry entry;
+        content = "data";
+        entry.Hash = md5(content);
+        FileContent current(entry, nullptr, hash);
+        CHECK(current.Matches(entry.Hash));
+        CHECK(current.Key(entry) == entry.Hash);
+        CHECK(reads == 1);
+    }
+    SUBCASE("A -> B -> A on seeded entry")
+    {
+        CacheEntry entry;
+        entry.Timestamp = 1;
+        entry.Hash = blob("A");
+        SUBCASE("racy checkouts")
+        {
+            // files written right after the index don't match it
+            content = "B";
+            FileContent b(entry, nullptr, hash);
+            CHECK(!b.Matches(entry.Hash));
+            CHECK(!entry.FindVersion(b));
+            entry.Push(b.Key(entry), 2, 4);
+            CHECK(entry.Hash == md5("B"));
+            content = "A";
+            FileContent a(entry, nullptr, hash);
+            CHECK(!a.Matches(entry.Hash));
+            auto version = entry.FindVersion(a);
+            REQUIRE(version);
+            CHECK(version->Timestamp == 1);
+            CHECK(reads == 2);
+        }
+        SUBCASE("stat matches index")
+        {
+            content = "B";
+            std::istringstream issB("B");
+            auto indexB = SHA1::GitBlobId(issB, 1);
+            FileContent b(entry, &indexB, hash);
+            CHECK(!b.Matches(entry.Hash));
+            CHECK(!entry.FindVersion(b));
+            entry.Push(b.Key(entry), 2, 4);
+            CHECK(entry.Hash == blob("B"));
+            std::istringstream issA("A");
+            auto indexA = SHA1::GitBlobId(issA, 1);
+            FileContent a(entry, &indexA, hash);
+            CHECK(!a.Matches(entry.Hash));
+            auto version = entry.FindVersion(a);
+            REQUIRE(version);
+            CHECK(version->Timestamp == 1);
+            CHECK(reads == 0);
+        }
+    }
+}
+
+TEST_CASE("CacheEntry::Push")
+{
+    CacheEntry entry;
+    entry.Timestamp = 1;
+    entry.Hash = "a";
+    SUBCASE("no history")
+    {
+        entry.Push("b", 2, 0);
+        CHECK(entry.Hash == "b");
+        CHECK(entry.Timestamp == 2);
+        CHECK(entry.History.empty());
+    }
+    SUBCASE("bounded, most recent first")
+    {
+        entry.Push("b", 2, 2);
+        entry.Push("c", 3, 2);
+        entry.Push("d", 4, 2);
+        CHECK(entry.Hash == "d");
+        REQUIRE(entry.History.size() == 2);
+        CHECK(entry.History[0].Hash == "c");
+        CHECK(entry.History[0].Timestamp == 3);
+        CHECK(entry.History[1].Hash == "b");
+        CHECK(entry.History[1].Timestamp == 2);
+    }
+    SUBCASE("returning version is taken out of history")
+    {
+        entry.Push("b", 2, 4);
+        entry.Push("a", 1, 4);
+        CHECK(entry.Hash == "a");
+        CHECK(entry.Timestamp == 1);
+        REQUIRE(entry.History.size() == 1);
+        CHECK(entry.History[0].Hash == "b");
+    }
+}
+
+TEST_CASE("SnapshotEntry Load & Save")
+{
+    SnapshotEntry entry;
+    entry.Stat.MTimeSec = 1589730132;
+    entry.Stat.MTimeNSec = 126981515;
+    entry.Stat.Size = 4096;
+    entry.Stat.Inode = 1835523;
+    std::ostringstream oss;
+    entry.Save(oss, "dir/a.txt");
+    CHECK(oss.str() == "1589730132 126981515 4096 1835523 \"dir/a.txt\"\n");
+    std::istringstream iss(oss.str());
+    SnapshotEntry loaded;
+    CHECK(loaded.Load(iss) == fs::path("dir") / "a.txt");
+    CHECK(loaded.Matches(entry.Stat));
+    auto changed = entry.Stat;
+    changed.Inode++;
+    CHECK(!loaded.Matches(changed));
+    std::istringstream bad("1589730132 126981515 4096 \"dir/a.txt\"");
+    CHECK_THROWS(loaded.Load(bad));
+}
+
+TEST_CASE("PartialHash Load & Save")
+{
+    PartialHash entry;
+    entry.Stat.MTimeSec = 1589730132;
+    entry.Stat.MTimeNSec = 126981515;
+    entry.Stat.Size = 1 << 20;
+    entry.Stat.Inode = 1835523;
+    entry.Offset = 65536;
+    entry.MD5State = MD5().Update("abc", 3).SaveState();
+    SUBCASE("md5 only")
+    {
+        std::ostringstream oss;
+        entry.Save(oss, "dir/big.bin");
+        CHECK(oss.str() == "1589730132 126981515 1048576 1835523 65536 " + entry.MD5State + " - \"dir/big.bin\"\n");
+        std::istringstream iss(oss.str());
+        PartialHash loaded;
+        CHECK(loaded.Load(iss) == fs::path("dir") / "big.bin");
+        CHECK(loaded.Matches(entry.Stat));
+        CHECK(loaded.Offset == 65536);
+        CHECK(loaded.MD5State == entry.MD5State);
+        CHECK(loaded.BlobState.empty());
+    }
+    SUBCASE("with blob state")
+    {
+        entry.BlobState = SHA1::GitBlob(entry.Stat.Size).SaveState();
+        std::ostringstream oss;
+        entry.Save(oss, "big.bin");
+        std::istringstream iss(oss.str());
+        PartialHash loaded;
+        CHECK(loaded.Load(iss) == "big.bin");
+        CHECK(loaded.BlobState == entry.BlobState);
+    }
+    std::istringstream bad("1589730132 126981515 1048576 1835523 65536 \"big.bin\"");
+    CHECK_THROWS(PartialHash().Load(bad));
+}
+
 TEST_CASE("RecursiveDirectoryIterator")
 {
     struct PathHasher
@@ -0,0 +1,126 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#include "Common/Config.hpp"
+#include "Trace.hpp"
+#include "Json.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio> // std::snprintf
+#include <fstream> // std::ofstream
+#include <memory> // std::unique_ptr
+#include <mutex>
+#include <stdexcept> // std::runtime_error
+#include <vector>
+
+namespace GCache
+{
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+struct Event
+{
+    char const *Name;
+    std::string Path;
+    int64_t Start; // ns since trace epoch
+    int64_t Duration; // ns
+    uint64_t Bytes;
+};
+
+struct ThreadBuffer
+{
+    uint32_t Id;
+    std::vector<Event> Events;
+};
+
+std::atomic<bool> enabled{false};
+Clock::time_point epoch;
+// registry is locked once per thread, events are appended lock-free
+std::mutex registryLock;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+ThreadBuffer &LocalBuffer()
+{
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (!buffer)
+    {
+        std::lock_guard<std::mutex> lock(registryLock);
+        registry.push_back(std::make_unique<ThreadBuffer>());
+        buffer = registry.back().get();
+        buffer->Id = uint32_t(registry.size());
+    }
+    return *buffer;
+}
+
+int64_t Now() noexcept
+{ return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count(); }
+} // namespace
+
+Trace::Scope::Scope(char const *name, std::filesystem::path const &path) :
+    name(name), active(Enabled())
+{
+    if (!active)
+        return;
+    if (!path.empty())
+        this->path = path.u8string();
+    start = Now();
+}
+
+Trace::Scope::~Scope()
+{
+    if (!active)
+        return;
+    auto end = Now();
+    LocalBuffer().Events.push_back({name, std::move(path), start, end - start, bytes});
+}
+
+void Trace::Enable() noexcept
+{
+    epoch = Clock::now();
+    enabled = true;
+}
+
+bool Trace::Enabled() noexcept
+{ return enabled.load(std::memory_order_relaxed); }
+
+void Trace::Save(std::filesystem::path const &path)
+{
+    std::ofstream ofs(path, std::ios::binary);
+    if (!ofs)
+        throw std::runtime_error("can't write trace: " + path.string());
+    std::lock_guard<std::mutex> lock(registryLock);
+    char buf[128];
+    char const *separator = "\n";
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (auto const &thread : registry)
+    {
+        std::snprintf(buf, sizeof(buf),
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+            thread->Id, thread->Id);
+        ofs << separator << buf;
+        separator = ",\n";
+        for (auto const &e : thread->Events)
+        {
+            // timestamps are in microseconds
+            std::snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld.%03lld,\"dur\":%lld.%03lld",
+                e.Name, thread->Id, (long long)e.Start/1000, (long long)e.Start%1000,
+                (long long)e.Duration/1000, (long long)e.Duration%1000);
+            ofs << separator << buf;
+            if (!e.Path.empty() || e.Bytes)
+            {
+                ofs << ",\"args\":{";
+                if (!e.Path.empty())
+                    ofs << "\"path\":" << JsonString(e.Path);
+                if (!e.Path.empty() && e.Bytes)
+                    ofs << ",";
+                if (e.Bytes)
+                    ofs << "\"bytes\":" << e.Bytes;
+                ofs << "}";
+            }
+            ofs << "}";
+        }
+    }
+    ofs << "\n]}\n";
+}
+} // namespace GCache
@@ -0,0 +1,45 @@
+// MIT License
+// Copyright (c) 2020 Pavel Kovalenko
+
+#pragma once
+
+#include "Common/Config.hpp"
+#include "GCacheCore.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace GCache
+{
+// Timeline of scoped events in Chrome trace-event format (viewable in
+// Perfetto or chrome://tracing). Each thread records into its own buffer,
+// so recording takes no locks; buffers are merged only by Save.
+class GCACHECORE_API Trace
+{
+public:
+    class GCACHECORE_API Scope
+    {
+    public:
+        // path is recorded as event argument, name must be a string literal
+        Scope(char const *name, std::filesystem::path const &path = {});
+        ~Scope();
+        Scope(Scope const &) = delete;
+        Scope &operator=(Scope const &) = delete;
+        void Bytes(uint64_t bytes) noexcept { this->bytes = bytes; }
+
+    private:
+        char const *name;
+        MSVC_WARN_PUSH_DISABLE(4251); // class needs to have dll-interface
+        std::string path;
+        MSVC_WARN_POP;
+        int64_t start;
+        uint64_t bytes = 0;
+        bool active;
+    };
+
+    static void Enable() noexcept;
+    static bool Enabled() noexcept;
+    // must not be called while other threads are still recording events
+    static void Save(std::filesystem::path const &path);
+};
+} // namespace GCache